@@ -0,0 +1,419 @@
+#!/usr/bin/env python3
+#
+# Boot time benchmark of gta04-init under qemu-system-arm
+# Copyright (c) 2026 agent <agent@local>
+#
+# gta04-init is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# Builds init and the files.txt initramfs into a vexpress-a9 kernel, creates
+# SD card image (FAT + ext4 + squashfs) for each scenario and boots it with
+# virtual framebuffer and scripted touch device. The rootfs /sbin/init is a
+# stub which prints kernel uptime, so the time from kernel start to
+# /sbin/init exec is measured by the guest itself.
+#
+# Results are written as JSON lines, one per run, followed by one summary
+# line per scenario with median values.
+
+import argparse
+import json
+import os
+import re
+import select
+import shutil
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+MIB = 1024 * 1024
+SD_SIZE = 128 * MIB     # qemu wants power of 2 SD card size
+PARTS = [               # (start, size, type) of p1 FAT, p2 ext4, p3 squashfs
+    (1 * MIB, 32 * MIB, "c"),
+    (33 * MIB, 48 * MIB, "83"),
+    (81 * MIB, 46 * MIB, "83"),
+]
+
+# Touch coordinates of menu items, see main() in gta04-init.c
+TAP_SD = (1000, 3000)
+TAP_1 = (1000, 1000)
+
+# Console lines printed by init and the stub
+RE_MENU = re.compile(r"waiting for touchscreen")
+RE_INIT = re.compile(r"BENCH init_exec ([0-9.]+)")
+RE_STAGED = re.compile(r"activated for next boot in ([0-9]+) us")
+RE_UBI = re.compile(
+    r"ubiattach status (-?[0-9]+) took ([0-9]+) us, drawing ([0-9]+) us")
+RE_MENU_TIME = re.compile(r"menu (drawn|restored) in ([0-9]+) us")
+RE_SYNCED = re.compile(r"BENCH synced")
+
+# What "ok" means in results: end marker that was reached without error. Only
+# bootdev, menu and script scenarios run until /sbin/init of the rootfs.
+END_NAMES = {
+    RE_INIT: "init_exec",
+    RE_STAGED: "kernel_staged",
+    RE_UBI: "ubiattach",
+    RE_SYNCED: "synced",
+}
+
+# bootdev file content, touch tap, kernel on rootfs differs, end marker and
+# warm (measure second boot of the same SD image, with menu snapshot saved)
+SCENARIOS = {
+    "bootdev": dict(bootdev="/dev/mmcblk0p2 /", tap=None,
+                    new_kernel=False, end=RE_INIT, warm=False),
+    "menu": dict(bootdev=None, tap=TAP_SD, new_kernel=False, end=RE_INIT,
+                 warm=False),
+    "menu-warm": dict(bootdev=None, tap=TAP_SD, new_kernel=False,
+                      end=RE_INIT, warm=True),
+    "kernel-update": dict(bootdev="/dev/mmcblk0p2 /", tap=None,
+                          new_kernel=True, end=RE_STAGED, warm=False),
+    "nand": dict(bootdev="ubi0:rootfs /", tap=None, new_kernel=False,
+                 end=RE_UBI, warm=False),
+    "script": dict(bootdev=None, tap=TAP_1, new_kernel=False, end=RE_INIT,
+                   warm=False),
+}
+
+# nandsim 16MiB NAND split so that the rest after 4 blocks is mtd4
+NANDSIM = ("nandsim.first_id_byte=0x20 nandsim.second_id_byte=0x33 "
+           "nandsim.parts=1,1,1,1")
+
+STUB_INIT = """#!/bin/sh
+mount -t proc proc /proc
+echo "BENCH init_exec $(cat /proc/uptime)"
+sync && echo "BENCH synced"
+exec sleep 3600
+"""
+
+SCRIPT_1 = """B=/fat/gta04-init/busybox
+$B mount -t squashfs /dev/mmcblk0p3 /real-root
+$B mount -t devtmpfs none /real-root/dev
+exec $B chroot /real-root /sbin/init
+"""
+
+
+def run(*cmd, **kw):
+    print("+ " + " ".join(cmd), file=sys.stderr)
+    subprocess.run(cmd, check=True, **kw)
+
+
+def build_init(args):
+    # Objects do not depend on KLCC, do not reuse ones built for the host
+    run("make", "-C", REPO, "clean")
+    run("make", "-C", REPO, "init", "KLCC=" + args.klcc)
+
+
+def build_kernel(args, work):
+    kbuild = os.path.join(work, "kernel")
+    make = ["make", "-C", args.kernel_src, "O=" + kbuild, "ARCH=arm",
+            "CROSS_COMPILE=" + args.cross_compile]
+
+    # files.txt paths are relative to parent of the repo
+    files = os.path.join(work, "files.txt")
+    with open(os.path.join(REPO, "files.txt")) as src, \
+            open(files, "w") as dst:
+        for line in src:
+            dst.write(line.replace(" gta04-init/", " " + REPO + "/"))
+
+    fragment = os.path.join(work, "kernel.config")
+    shutil.copyfile(os.path.join(REPO, "bench", "kernel.config"), fragment)
+    with open(fragment, "a") as f:
+        f.write('CONFIG_INITRAMFS_SOURCE="%s"\n' % files)
+
+    os.makedirs(kbuild, exist_ok=True)
+    run(*make, "vexpress_defconfig")
+    run(os.path.join(args.kernel_src, "scripts", "kconfig",
+                     "merge_config.sh"), "-m", "-O", kbuild,
+        os.path.join(kbuild, ".config"), fragment,
+        env=dict(os.environ, ARCH="arm"))
+    run(*make, "olddefconfig")
+    run(*make, "-j%d" % os.cpu_count(), "zImage", "dtbs")
+
+    zimage = os.path.join(kbuild, "arch", "arm", "boot", "zImage")
+    for dts in ("dts", os.path.join("dts", "arm")):
+        dtb = os.path.join(kbuild, "arch", "arm", "boot", dts,
+                           "vexpress-v2p-ca9.dtb")
+        if os.path.exists(dtb):
+            return zimage, dtb
+    sys.exit("vexpress-v2p-ca9.dtb not found in " + kbuild)
+
+
+def build_rootfs(args, work, kernel):
+    rootfs = os.path.join(work, "rootfs")
+    shutil.rmtree(rootfs, ignore_errors=True)
+    for d in ("bin", "sbin", "boot", "dev", "proc"):
+        os.makedirs(os.path.join(rootfs, d))
+    shutil.copy(args.busybox, os.path.join(rootfs, "bin", "busybox"))
+    for applet in ("sh", "mount", "cat", "sleep", "sync"):
+        os.symlink("busybox", os.path.join(rootfs, "bin", applet))
+    init = os.path.join(rootfs, "sbin", "init")
+    with open(init, "w") as f:
+        f.write(STUB_INIT)
+    os.chmod(init, 0o755)
+    shutil.copyfile(kernel, os.path.join(rootfs, "boot", "uImage"))
+    return rootfs
+
+
+def build_sd(args, work, name, scenario, zimage):
+    sd = os.path.join(work, name)
+    os.makedirs(sd, exist_ok=True)
+
+    # FAT kernel is the built one, rootfs kernel differs for kernel update
+    with open(zimage, "rb") as f:
+        kernel = bytearray(f.read())
+    fat_kernel = os.path.join(sd, "uImage")
+    with open(fat_kernel, "wb") as f:
+        f.write(kernel)
+    root_kernel = os.path.join(sd, "uImage.root")
+    if scenario["new_kernel"]:
+        kernel[-4096:] = bytes(b ^ 0xff for b in kernel[-4096:])
+    with open(root_kernel, "wb") as f:
+        f.write(kernel)
+    rootfs = build_rootfs(args, sd, root_kernel)
+
+    fat = os.path.join(sd, "fat.img")
+    if os.path.exists(fat):
+        os.unlink(fat)
+    run("mkfs.vfat", "-C", fat, str(PARTS[0][1] // 1024))
+    run("mmd", "-i", fat, "::gta04-init")
+    run("mcopy", "-i", fat, fat_kernel, "::uImage")
+    run("mcopy", "-i", fat, args.busybox, "::gta04-init/busybox")
+    script = os.path.join(sd, "1.sh")
+    with open(script, "w") as f:
+        f.write(SCRIPT_1)
+    run("mcopy", "-i", fat, script, "::gta04-init/1.sh")
+    if scenario["bootdev"]:
+        bootdev = os.path.join(sd, "bootdev")
+        with open(bootdev, "w") as f:
+            f.write(scenario["bootdev"] + "\n")
+        run("mcopy", "-i", fat, bootdev, "::gta04-init/bootdev")
+
+    ext4 = os.path.join(sd, "ext4.img")
+    if os.path.exists(ext4):
+        os.unlink(ext4)
+    run("mkfs.ext4", "-q", "-F", "-E", "root_owner=0:0", "-d", rootfs,
+        ext4, "%dK" % (PARTS[1][1] // 1024))
+
+    squashfs = os.path.join(sd, "squashfs.img")
+    run("mksquashfs", rootfs, squashfs, "-noappend", "-all-root", "-quiet")
+    if os.path.getsize(squashfs) > PARTS[2][1]:
+        sys.exit("squashfs image does not fit partition 3")
+
+    image = os.path.join(sd, "sd.img")
+    with open(image, "wb") as f:
+        f.truncate(SD_SIZE)
+    table = "label: dos\n" + "".join(
+        "start=%d, size=%d, type=%s\n" % (start // 512, size // 512, ptype)
+        for start, size, ptype in PARTS)
+    run("sfdisk", "-q", image, input=table.encode())
+    for (start, size, ptype), part in zip(PARTS, (fat, ext4, squashfs)):
+        run("dd", "if=" + part, "of=" + image, "bs=1M",
+            "seek=%d" % (start // MIB), "conv=notrunc,sparse", "status=none")
+    return image
+
+
+class Qmp:
+    def __init__(self, path, timeout):
+        deadline = time.monotonic() + timeout
+        while True:
+            try:
+                self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+                self.sock.connect(path)
+                break
+            except OSError:
+                self.sock.close()
+                if time.monotonic() > deadline:
+                    raise
+                time.sleep(0.01)
+        self.file = self.sock.makefile("rw")
+        self.file.readline()    # greeting
+        self.execute("qmp_capabilities")
+
+    def execute(self, cmd, **arguments):
+        self.file.write(json.dumps(dict(execute=cmd, arguments=arguments)))
+        self.file.flush()
+        while True:
+            reply = json.loads(self.file.readline())
+            if "error" in reply:
+                raise RuntimeError(reply["error"])
+            if "return" in reply:
+                return reply["return"]
+
+    def tap(self, x, y):
+        self.execute("input-send-event", events=[
+            dict(type="abs", data=dict(axis="x", value=x)),
+            dict(type="abs", data=dict(axis="y", value=y)),
+        ])
+
+    def close(self):
+        self.sock.close()
+
+
+def boot_once(args, name, scenario, image, zimage, dtb, log_name, end):
+    workdir = tempfile.mkdtemp(prefix="qemu-bench-")
+    qmp_path = os.path.join(workdir, "qmp.sock")
+
+    append = "console=ttyAMA0 quiet"
+    if name == "nand":
+        append += " " + NANDSIM
+    cmd = [args.qemu, "-M", "vexpress-a9", "-m", "256", "-kernel", zimage,
+           "-dtb", dtb, "-append", append,
+           "-drive", "if=sd,format=raw,file=" + image,
+           "-device", "virtio-tablet-device",
+           "-display", "none", "-serial", "stdio", "-monitor", "none",
+           "-qmp", "unix:%s,server=on,wait=off" % qmp_path, "-no-reboot"]
+    if args.icount:
+        cmd += ["-icount", args.icount]
+
+    result = dict(init_exec_s=None, menu=None, menu_us=None,
+                  ubiattach_status=None, ubiattach_us=None, kernel_stage_us=None, draw_us=None,
+                  wall_s=None, reached=None, ok=False)
+    start = time.monotonic()
+    qemu = subprocess.Popen(cmd, stdin=subprocess.DEVNULL,
+                            stdout=subprocess.PIPE)
+    qmp = None
+    buf = b""
+    tapped = False
+    log = open(os.path.join(args.workdir, log_name), "wb")
+    try:
+        qmp = Qmp(qmp_path, args.timeout)
+        while time.monotonic() - start < args.timeout:
+            ready, _, _ = select.select([qemu.stdout], [], [], 0.1)
+            if not ready:
+                if qemu.poll() is not None:
+                    break
+                continue
+            data = os.read(qemu.stdout.fileno(), 4096)
+            if not data:
+                break
+            log.write(data)
+            buf += data
+            *lines, buf = buf.split(b"\n")
+            for line in lines:
+                line = line.decode(errors="replace").strip("\r")
+                if scenario["tap"] and not tapped and RE_MENU.search(line):
+                    qmp.tap(*scenario["tap"])
+                    tapped = True
+                m = RE_INIT.search(line)
+                if m:
+                    result["init_exec_s"] = float(m.group(1))
+                m = RE_MENU_TIME.search(line)
+                if m:
+                    result["menu"] = m.group(1)
+                    result["menu_us"] = int(m.group(2))
+                m = RE_UBI.search(line)
+                if m:
+                    result["ubiattach_status"] = int(m.group(1))
+                    result["ubiattach_us"] = int(m.group(2))
+                    result["draw_us"] = int(m.group(3))
+                m = RE_STAGED.search(line)
+                if m:
+                    result["kernel_stage_us"] = int(m.group(1))
+                if end.search(line):
+                    result["reached"] = END_NAMES[end]
+                    result["ok"] = result["ubiattach_status"] in (None, 0)
+            if result["reached"]:
+                break
+    finally:
+        result["wall_s"] = round(time.monotonic() - start, 3)
+        if qmp:
+            qmp.close()
+        qemu.kill()
+        qemu.wait()
+        log.close()
+        shutil.rmtree(workdir, ignore_errors=True)
+    return result
+
+
+def boot(args, name, scenario, template, zimage, dtb, run_no):
+    workdir = tempfile.mkdtemp(prefix="qemu-bench-")
+    image = os.path.join(workdir, "sd.img")
+    run("cp", "--sparse=always", template, image)
+    try:
+        # First boot saves menu snapshot, wait until stub init synced it
+        if scenario["warm"]:
+            cold = boot_once(args, name, scenario, image, zimage, dtb,
+                             "%s-%d-cold.log" % (name, run_no), RE_SYNCED)
+            if not cold["ok"]:
+                return dict(scenario=name, run=run_no, **cold)
+        result = boot_once(args, name, scenario, image, zimage, dtb,
+                           "%s-%d.log" % (name, run_no), scenario["end"])
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+    if scenario["warm"] and result["menu"] != "restored":
+        result["ok"] = False
+    return dict(scenario=name, run=run_no, **result)
+
+
+def summary(name, results):
+    ok = [r for r in results if r["ok"]]
+    line = dict(scenario=name, summary=True, runs=len(results),
+                failed=len(results) - len(ok),
+                reached=END_NAMES[SCENARIOS[name]["end"]])
+    for key in ("init_exec_s", "menu_us", "ubiattach_us", "kernel_stage_us",
+                "draw_us", "wall_s"):
+        values = [r[key] for r in ok if r[key] is not None]
+        line[key + "_median"] = statistics.median(values) if values else None
+    return line
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Boot time benchmark of gta04-init under qemu-system-arm")
+    parser.add_argument("--kernel-src", default=os.environ.get("KERNEL_SRC"),
+                        help="linux source tree (default $KERNEL_SRC)")
+    parser.add_argument("--cross-compile",
+                        default=os.environ.get("CROSS_COMPILE",
+                                               "arm-linux-gnueabihf-"))
+    parser.add_argument("--klcc", default=os.environ.get("KLCC", "klcc"),
+                        help="klcc targeting ARM")
+    parser.add_argument("--busybox", default=os.environ.get("BUSYBOX"),
+                        help="static ARM busybox (default $BUSYBOX)")
+    parser.add_argument("--qemu", default="qemu-system-arm")
+    parser.add_argument("--icount", default="shift=1",
+                        help="qemu -icount value for instruction counted "
+                        "guest clock, empty to disable")
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--timeout", type=float, default=120)
+    parser.add_argument("--workdir",
+                        default=os.path.join(REPO, "bench", "work"))
+    parser.add_argument("--output", default="-",
+                        help="JSON lines output file (default stdout)")
+    parser.add_argument("scenarios", nargs="*", default=list(SCENARIOS),
+                        help="subset of: " + " ".join(SCENARIOS))
+    args = parser.parse_args()
+
+    if not args.kernel_src or not args.busybox:
+        parser.error("--kernel-src and --busybox are required")
+    for name in args.scenarios:
+        if name not in SCENARIOS:
+            parser.error("unknown scenario " + name)
+    args.workdir = os.path.abspath(args.workdir)
+    os.makedirs(args.workdir, exist_ok=True)
+
+    build_init(args)
+    zimage, dtb = build_kernel(args, args.workdir)
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+
+    failed = 0
+    for name in args.scenarios:
+        scenario = SCENARIOS[name]
+        template = build_sd(args, args.workdir, name, scenario, zimage)
+        results = []
+        for run_no in range(args.runs):
+            result = boot(args, name, scenario, template, zimage, dtb, run_no)
+            results.append(result)
+            print(json.dumps(result), file=out, flush=True)
+        line = summary(name, results)
+        failed += line["failed"]
+        print(json.dumps(line), file=out, flush=True)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
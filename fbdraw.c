@@ -0,0 +1,511 @@
+/*
+ * GTA04 init framebuffer text and progress drawing
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * gta04-init is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * gta04-init is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with gta04-init; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Text is drawn from glyphs pre-rasterized in framebuffer pixel format, so
+ * drawing a character is just FB_CELL_H row copies. Only the rectangles
+ * being changed are touched, the rest of the screen is left as it is.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <linux/fb.h>
+
+#include "fbdraw.h"
+
+#define FONT_FIRST 32
+#define FONT_LAST 126
+#define FONT_COUNT (FONT_LAST - FONT_FIRST + 1)
+#define FONT_W 5
+#define FONT_H 7
+
+#define SNAPSHOT_MAGIC "GTA04FB1"
+#define SNAPSHOT_HEADER 4096    // fb data in snapshot starts page aligned
+#define SNAPSHOT_KEY 256
+
+#define COLOR_FG 0xffffff
+#define COLOR_BG 0x000000
+#define COLOR_BAR 0x3080ff
+
+// 5x7 font, one byte per row, bit 4 is leftmost pixel
+static const unsigned char font[FONT_COUNT][FONT_H] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},   // ' '
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04},   // '!'
+    {0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00},   // '"'
+    {0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a},   // '#'
+    {0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04},   // '$'
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03},   // '%'
+    {0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d},   // '&'
+    {0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00},   // '\''
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02},   // '('
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08},   // ')'
+    {0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00},   // '*'
+    {0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00},   // '+'
+    {0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08},   // ','
+    {0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00},   // '-'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c},   // '.'
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00},   // '/'
+    {0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e},   // '0'
+    {0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e},   // '1'
+    {0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f},   // '2'
+    {0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e},   // '3'
+    {0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02},   // '4'
+    {0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e},   // '5'
+    {0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e},   // '6'
+    {0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},   // '7'
+    {0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e},   // '8'
+    {0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c},   // '9'
+    {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00},   // ':'
+    {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08},   // ';'
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02},   // '<'
+    {0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00},   // '='
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08},   // '>'
+    {0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04},   // '?'
+    {0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e},   // '@'
+    {0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11},   // 'A'
+    {0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e},   // 'B'
+    {0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e},   // 'C'
+    {0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c},   // 'D'
+    {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f},   // 'E'
+    {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10},   // 'F'
+    {0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f},   // 'G'
+    {0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11},   // 'H'
+    {0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e},   // 'I'
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c},   // 'J'
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},   // 'K'
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f},   // 'L'
+    {0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11},   // 'M'
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},   // 'N'
+    {0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e},   // 'O'
+    {0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10},   // 'P'
+    {0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d},   // 'Q'
+    {0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11},   // 'R'
+    {0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e},   // 'S'
+    {0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},   // 'T'
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e},   // 'U'
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04},   // 'V'
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a},   // 'W'
+    {0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11},   // 'X'
+    {0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04},   // 'Y'
+    {0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f},   // 'Z'
+    {0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e},   // '['
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00},   // '\\'
+    {0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e},   // ']'
+    {0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00},   // '^'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f},   // '_'
+    {0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00},   // '`'
+    {0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f},   // 'a'
+    {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e},   // 'b'
+    {0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e},   // 'c'
+    {0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f},   // 'd'
+    {0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e},   // 'e'
+    {0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08},   // 'f'
+    {0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e},   // 'g'
+    {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11},   // 'h'
+    {0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e},   // 'i'
+    {0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c},   // 'j'
+    {0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12},   // 'k'
+    {0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e},   // 'l'
+    {0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11},   // 'm'
+    {0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11},   // 'n'
+    {0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e},   // 'o'
+    {0x00, 0x00, 0x1e, 0x11, 0x1e, 0x10, 0x10},   // 'p'
+    {0x00, 0x00, 0x0d, 0x13, 0x0f, 0x01, 0x01},   // 'q'
+    {0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10},   // 'r'
+    {0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e},   // 's'
+    {0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06},   // 't'
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d},   // 'u'
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04},   // 'v'
+    {0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a},   // 'w'
+    {0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11},   // 'x'
+    {0x00, 0x00, 0x11, 0x11, 0x0f, 0x01, 0x0e},   // 'y'
+    {0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f},   // 'z'
+    {0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02},   // '{'
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},   // '|'
+    {0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08},   // '}'
+    {0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00},   // '~'
+};
+
+static int fbfd = -1;
+static char *fbmap = NULL;
+static size_t fblen;
+static struct fb_var_screeninfo screen_info;
+static struct fb_fix_screeninfo fixed_info;
+static int pix_bytes;
+static char *glyphs = NULL;     // FONT_COUNT cells of FB_CELL_W x FB_CELL_H
+static long draw_usecs;
+
+long fb_usecs(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+long fb_draw_usecs(void)
+{
+    return draw_usecs;
+}
+
+static unsigned int fb_pixel(unsigned int rgb)
+{
+    unsigned int r = (rgb >> 16) & 0xff;
+    unsigned int g = (rgb >> 8) & 0xff;
+    unsigned int b = rgb & 0xff;
+
+    return ((r >> (8 - screen_info.red.length)) << screen_info.red.offset) |
+        ((g >> (8 - screen_info.green.length)) << screen_info.green.offset) |
+        ((b >> (8 - screen_info.blue.length)) << screen_info.blue.offset);
+}
+
+static void put_pixel(char *dst, unsigned int pixel)
+{
+    int i;
+    for (i = 0; i < pix_bytes; i++) {
+        dst[i] = pixel >> (8 * i);
+    }
+}
+
+// Fill rectangle clipped to screen: first row by pixels, the rest by copy
+static void fb_fill(int left, int top, int width, int height, unsigned int rgb)
+{
+    unsigned int pixel = fb_pixel(rgb);
+    char *row;
+    int x, y;
+
+    if (left + width > (int)screen_info.xres)
+        width = screen_info.xres - left;
+    if (top + height > (int)screen_info.yres)
+        height = screen_info.yres - top;
+    if (left < 0 || top < 0 || width <= 0 || height <= 0)
+        return;
+
+    row = fbmap + top * fixed_info.line_length + left * pix_bytes;
+    for (x = 0; x < width; x++) {
+        put_pixel(row + x * pix_bytes, pixel);
+    }
+    for (y = 1; y < height; y++) {
+        memcpy(row + y * fixed_info.line_length, row, width * pix_bytes);
+    }
+}
+
+static void rasterize_glyphs(void)
+{
+    unsigned int fg = fb_pixel(COLOR_FG);
+    unsigned int bg = fb_pixel(COLOR_BG);
+    int line_len = FB_CELL_W * pix_bytes;
+    int c, x, y;
+    char *cell;
+
+    for (c = 0; c < FONT_COUNT; c++) {
+        cell = glyphs + c * FB_CELL_H * line_len;
+        for (y = 0; y < FB_CELL_H; y++) {
+            for (x = 0; x < FB_CELL_W; x++) {
+                int fx = x / FB_FONT_SCALE;
+                int fy = y / FB_FONT_SCALE - 1;     // one empty row on top
+                int on = fx < FONT_W && fy >= 0 && fy < FONT_H &&
+                    (font[c][fy] & (0x10 >> fx));
+                put_pixel(cell + y * line_len + x * pix_bytes, on ? fg : bg);
+            }
+        }
+    }
+}
+
+int fb_open(void)
+{
+    if (fbmap) {
+        return 0;
+    }
+
+    fbfd = open("/dev/fb0", O_RDWR);
+    if (fbfd < 0) {
+        perror("fb open failed");
+        return -1;
+    }
+
+    if (ioctl(fbfd, FBIOGET_VSCREENINFO, &screen_info) ||
+        ioctl(fbfd, FBIOGET_FSCREENINFO, &fixed_info)) {
+        perror("fb info failed");
+        goto err;
+    }
+
+    pix_bytes = screen_info.bits_per_pixel / 8;
+    if (pix_bytes < 2 || pix_bytes > 4) {
+        printf("fb: unsupported %d bpp\n", screen_info.bits_per_pixel);
+        goto err;
+    }
+
+    glyphs = malloc(FONT_COUNT * FB_CELL_H * FB_CELL_W * pix_bytes);
+    if (glyphs == NULL) {
+        perror("glyph cache");
+        goto err;
+    }
+
+    fblen = screen_info.yres_virtual * fixed_info.line_length;
+    fbmap = mmap(NULL, fblen, PROT_READ | PROT_WRITE, MAP_SHARED, fbfd, 0);
+    if (fbmap == MAP_FAILED) {
+        perror("fb mmap failed");
+        fbmap = NULL;
+        goto err;
+    }
+
+    rasterize_glyphs();
+    return 0;
+
+err:
+    fb_close();
+    return -1;
+}
+
+void fb_close(void)
+{
+    if (fbmap)
+        munmap(fbmap, fblen);
+    fbmap = NULL;
+
+    if (fbfd >= 0)
+        close(fbfd);
+    fbfd = -1;
+
+    free(glyphs);
+    glyphs = NULL;
+}
+
+void fb_clear(void)
+{
+    long start;
+
+    if (fbmap == NULL) {
+        return;
+    }
+    start = fb_usecs();
+    memset(fbmap, 0, fblen);
+    draw_usecs += fb_usecs() - start;
+}
+
+void fb_blit(int left, int top, const char *src, int line_len, int height,
+             int stride)
+{
+    long start;
+    int y;
+
+    if (fbmap == NULL || left < 0 || top < 0) {
+        return;
+    }
+    if (top + height > (int)screen_info.yres)
+        height = screen_info.yres - top;
+    if (left * pix_bytes + line_len > (int)fixed_info.line_length)
+        line_len = fixed_info.line_length - left * pix_bytes;
+    if (line_len <= 0)
+        return;
+
+    start = fb_usecs();
+    for (y = 0; y < height; y++) {
+        memcpy(fbmap + left * pix_bytes + (top + y) * fixed_info.line_length,
+               src + y * stride, line_len);
+    }
+    draw_usecs += fb_usecs() - start;
+}
+
+struct fb_snapshot_header {
+    char magic[8];
+    unsigned int xres;
+    unsigned int yres;
+    unsigned int bits_per_pixel;
+    unsigned int line_length;
+    struct fb_bitfield red;
+    struct fb_bitfield green;
+    struct fb_bitfield blue;
+    struct fb_bitfield transp;
+    char key[SNAPSHOT_KEY];
+};
+
+static void snapshot_header(char *page, const char *key)
+{
+    struct fb_snapshot_header *hdr = (struct fb_snapshot_header *)page;
+
+    memset(page, 0, SNAPSHOT_HEADER);
+    memcpy(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic));
+    hdr->xres = screen_info.xres;
+    hdr->yres = screen_info.yres;
+    hdr->bits_per_pixel = screen_info.bits_per_pixel;
+    hdr->line_length = fixed_info.line_length;
+    hdr->red = screen_info.red;
+    hdr->green = screen_info.green;
+    hdr->blue = screen_info.blue;
+    hdr->transp = screen_info.transp;
+    snprintf(hdr->key, sizeof(hdr->key), "%s", key);
+}
+
+int fb_snapshot_save(const char *path, const char *key)
+{
+    char page[SNAPSHOT_HEADER];
+    char tmp[256];
+    size_t len = screen_info.yres * fixed_info.line_length;
+    int fd;
+
+    if (fbmap == NULL) {
+        return -1;
+    }
+    snapshot_header(page, key);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 00644)) < 0) {
+        perror(tmp);
+        return -1;
+    }
+    if (write(fd, page, SNAPSHOT_HEADER) != SNAPSHOT_HEADER ||
+        write(fd, fbmap, len) != (ssize_t)len || fsync(fd) < 0) {
+        perror(tmp);
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp, path) < 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+// Header is checked first, then fb content is read straight to fb mapping
+int fb_snapshot_restore(const char *path, const char *key)
+{
+    char page[SNAPSHOT_HEADER];
+    char file_page[SNAPSHOT_HEADER];
+    size_t len = screen_info.yres * fixed_info.line_length;
+    long start;
+    int fd;
+
+    if (fbmap == NULL) {
+        return -1;
+    }
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    snapshot_header(page, key);
+    if (read(fd, file_page, SNAPSHOT_HEADER) != SNAPSHOT_HEADER ||
+        memcmp(page, file_page, SNAPSHOT_HEADER) != 0) {
+        printf("fb snapshot %s is stale\n", path);
+        close(fd);
+        return -1;
+    }
+
+    start = fb_usecs();
+    if (read(fd, fbmap, len) != (ssize_t)len) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    draw_usecs += fb_usecs() - start;
+    close(fd);
+    return 0;
+}
+
+void fb_text(int left, int top, int width, const char *text)
+{
+    int line_len = FB_CELL_W * pix_bytes;
+    int right = left + width;
+    long start;
+    int x, y, c;
+    char *cell;
+
+    if (fbmap == NULL || left < 0 || top < 0 ||
+        top + FB_CELL_H > (int)screen_info.yres) {
+        return;
+    }
+
+    if (width <= 0 || right > (int)screen_info.xres) {
+        right = screen_info.xres;
+    }
+
+    start = fb_usecs();
+    for (x = left; x + FB_CELL_W <= right; x += FB_CELL_W) {
+        if (*text) {
+            c = (unsigned char)*text++;
+        } else if (width > 0) {
+            c = ' ';
+        } else {
+            break;
+        }
+        if (c < FONT_FIRST || c > FONT_LAST) {
+            c = '?';
+        }
+        cell = glyphs + (c - FONT_FIRST) * FB_CELL_H * line_len;
+        for (y = 0; y < FB_CELL_H; y++) {
+            memcpy(fbmap + (top + y) * fixed_info.line_length +
+                   x * pix_bytes, cell + y * line_len, line_len);
+        }
+    }
+    draw_usecs += fb_usecs() - start;
+}
+
+void fb_progress_init(struct fb_progress *bar, int left, int top, int width,
+                      int height)
+{
+    bar->left = left;
+    bar->top = top;
+    bar->width = width;
+    bar->height = height;
+    bar->filled = -1;
+}
+
+// Draw frame on first use, then only the columns which changed
+void fb_progress_set(struct fb_progress *bar, long done, long total)
+{
+    int inner = bar->width - 4;
+    int filled;
+    long start;
+
+    if (fbmap == NULL || inner <= 0) {
+        return;
+    }
+    if (done < 0)
+        done = 0;
+    if (done > total)
+        done = total;
+    filled = total > 0 ? (int)((long long)inner * done / total) : 0;
+    if (filled == bar->filled) {
+        return;
+    }
+
+    start = fb_usecs();
+    if (bar->filled < 0) {
+        fb_fill(bar->left, bar->top, bar->width, bar->height, COLOR_FG);
+        fb_fill(bar->left + 1, bar->top + 1, bar->width - 2,
+                bar->height - 2, COLOR_BG);
+        bar->filled = 0;
+    }
+    if (filled > bar->filled) {
+        fb_fill(bar->left + 2 + bar->filled, bar->top + 2,
+                filled - bar->filled, bar->height - 4, COLOR_BAR);
+    } else {
+        fb_fill(bar->left + 2 + filled, bar->top + 2,
+                bar->filled - filled, bar->height - 4, COLOR_BG);
+    }
+    bar->filled = filled;
+    draw_usecs += fb_usecs() - start;
+}
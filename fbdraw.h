@@ -0,0 +1,74 @@
+/*
+ * GTA04 init framebuffer text and progress drawing
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * gta04-init is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * gta04-init is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with gta04-init; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FBDRAW_H
+#define FBDRAW_H
+
+// Glyph cell size in pixels including spacing
+#define FB_FONT_SCALE 3
+#define FB_CELL_W (6 * FB_FONT_SCALE)
+#define FB_CELL_H (9 * FB_FONT_SCALE)
+
+// Status line and progress bar below the 128x128 logo, 24 characters fit
+#define FB_STATUS_LEFT 16
+#define FB_STATUS_TOP 416
+#define FB_STATUS_WIDTH 448
+#define FB_MENU_STATUS_TOP 576  // below the menu pictures
+#define FB_PROGRESS_TOP (FB_STATUS_TOP + FB_CELL_H + 8)
+#define FB_PROGRESS_HEIGHT 16
+
+struct fb_progress {
+    int left;
+    int top;
+    int width;
+    int height;
+    int filled;                 // filled width in pixels, -1 if not drawn yet
+};
+
+// Map /dev/fb0 and rasterize glyphs in fb pixel format. The mapping is kept
+// open, so it also works in children after /dev is gone.
+int fb_open(void);
+void fb_close(void);
+
+// Clear whole screen
+void fb_clear(void);
+
+// Copy height rows of line_len bytes to left, top. Source rows are stride
+// bytes apart, negative stride is for bottom-up images.
+void fb_blit(int left, int top, const char *src, int line_len, int height,
+             int stride);
+
+// Save visible screen to path as header page followed by raw fb content.
+// Restore succeeds only if fb geometry and key (asset identity) match.
+int fb_snapshot_save(const char *path, const char *key);
+int fb_snapshot_restore(const char *path, const char *key);
+
+// Draw text clipped to width pixels and clear the rest of them. With width 0
+// only the text is drawn, clipped at screen edge.
+void fb_text(int left, int top, int width, const char *text);
+
+void fb_progress_init(struct fb_progress *bar, int left, int top, int width,
+                      int height);
+void fb_progress_set(struct fb_progress *bar, long done, long total);
+
+// Current time and total time spent drawing in microseconds
+long fb_usecs(void);
+long fb_draw_usecs(void);
+
+#endif
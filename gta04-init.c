@@ -27,12 +27,18 @@
 #include <sys/stat.h>
 #include <sys/mount.h>
 #include <sys/types.h>
+#include <sys/sysmacros.h>
 #include <sys/wait.h>
 #include <sys/reboot.h>
 #include <linux/fb.h>
 #include <linux/input.h>
 
 #include "run-init.h"
+#include "fbdraw.h"
+
+#ifndef MNT_DETACH
+# define MNT_DETACH 2
+#endif
 
 // Write string count bytes long to file
 void writen_file(const char *path, const char *value, size_t count)
@@ -62,14 +68,8 @@ void write_file(const char *path, const char *value)
 int bmp_draw(const char *path, int left, int top, int fbclear)
 {
     int filefd = -1;
-    int fbfd = -1;
     char *filemap = NULL;
-    char *fbmap = NULL;
-    size_t fblen;
-    struct fb_var_screeninfo screen_info;
-    struct fb_fix_screeninfo fixed_info;
     struct stat st;
-    int y;
 
     filefd = open(path, O_RDONLY);
     if (filefd == -1) {
@@ -82,51 +82,27 @@ int bmp_draw(const char *path, int left, int top, int fbclear)
         goto cleanup;
     }
 
-    filemap = mmap(0, st.st_size, PROT_READ, MAP_SHARED, filefd, 0);
-    if (filemap == MAP_FAILED) {
-        close(filefd);
-        perror("file mmap failed");
-        goto cleanup;
-    }
-
-    fbfd = open("/dev/fb0", O_RDWR);
-    if (fbfd < 0) {
-        perror("fb open failed");
-        goto cleanup;
-    }
-
-    if (ioctl(fbfd, FBIOGET_VSCREENINFO, &screen_info) ||
-        ioctl(fbfd, FBIOGET_FSCREENINFO, &fixed_info)) {
-        perror("fb info failed");
+    if (st.st_size < BMP_SIZE) {
+        printf("%s: bmp too small\n", path);
         goto cleanup;
     }
 
-    fblen = screen_info.yres_virtual * fixed_info.line_length;
-    fbmap = mmap(NULL, fblen, PROT_READ | PROT_WRITE, MAP_SHARED, fbfd, 0);
-
-    if (fbmap == MAP_FAILED) {
-        perror("fb mmap failed");
+    filemap = mmap(0, st.st_size, PROT_READ, MAP_SHARED, filefd, 0);
+    if (filemap == MAP_FAILED) {
+        perror("file mmap failed");
         goto cleanup;
     }
 
     if (fbclear) {
-        memset(fbmap, 0, fblen);
+        fb_clear();
     }
 
-    for (y = 0; y < BMP_HEIGHT; y++) {
-        memmove(fbmap + left * BMP_PIX_BYTES +
-                (top + y) * fixed_info.line_length,
-                filemap + st.st_size - (y + 1) * BMP_LINE_LEN, BMP_LINE_LEN);
-    }
+    // Rows are stored bottom-up at the end of file
+    fb_blit(left, top, filemap + st.st_size - BMP_LINE_LEN, BMP_LINE_LEN,
+            BMP_HEIGHT, -BMP_LINE_LEN);
 
 cleanup:
 
-    if (fbmap && fbmap != MAP_FAILED)
-        munmap(fbmap, fblen);
-
-    if (fbfd >= 0)
-        close(fbfd);
-
     if (filemap && filemap != MAP_FAILED)
         munmap(filemap, st.st_size);
 
@@ -136,6 +112,71 @@ cleanup:
     return 0;
 }
 
+#define MENU_SNAPSHOT "/fat/gta04-init/menu.fb"
+
+// FNV-1a hash of file content, 0 if it can not be read
+static unsigned int file_checksum(const char *path)
+{
+    unsigned int hash = 2166136261u;
+    unsigned char buf[4096];
+    int fd, rb, i;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return 0;
+    }
+    while ((rb = read(fd, buf, sizeof(buf))) > 0) {
+        for (i = 0; i < rb; i++) {
+            hash = (hash ^ buf[i]) * 16777619u;
+        }
+    }
+    close(fd);
+    return hash;
+}
+
+// Identify init and menu pictures by size and content checksum, so that menu
+// snapshot is drawn again when any of them changes. Initramfs mtimes can be
+// all the same (KBUILD_BUILD_TIMESTAMP), so they are not used.
+static void menu_key(char *key, size_t len)
+{
+    const char *files[] = { "/init", "/pic/sd.bmp", "/pic/nand.bmp",
+        "/pic/1.bmp", "/pic/2.bmp"
+    };
+    struct stat st;
+    size_t n = 0;
+    int i;
+
+    key[0] = 0;
+    for (i = 0; i < 5 && n < len; i++) {
+        if (stat(files[i], &st) < 0) {
+            st.st_size = 0;
+        }
+        n += snprintf(key + n, len - n, "%ld:%08x ", (long)st.st_size,
+                      file_checksum(files[i]));
+    }
+}
+
+// Restore composed menu from snapshot on FAT. If it is missing or stale,
+// draw the menu from pictures and save new snapshot.
+static void menu_draw(void)
+{
+    char key[256];
+    long start = fb_usecs();
+
+    menu_key(key, sizeof(key));
+    if (fb_snapshot_restore(MENU_SNAPSHOT, key) == 0) {
+        printf("menu restored in %ld us\n", fb_usecs() - start);
+        return;
+    }
+
+    bmp_draw("/pic/sd.bmp", 56, 96, 1);
+    bmp_draw("/pic/nand.bmp", 56 + 240, 96, 0);
+    bmp_draw("/pic/1.bmp", 56, 320 + 96, 0);
+    bmp_draw("/pic/2.bmp", 56 + 240, 320 + 96, 0);
+    printf("menu drawn in %ld us\n", fb_usecs() - start);
+
+    fb_snapshot_save(MENU_SNAPSHOT, key);
+}
+
 static int mount_fs(const char *fstype, const char *device,
                     const char *mountpoint)
 {
@@ -147,118 +188,267 @@ static int mount_fs(const char *fstype, const char *device,
     return -1;
 }
 
-// Compare src and dst files. Return 0 if their content is same. Copy src to
-// dst and return 1 if they are different. On error returns negative error
-// code.
-static int update_file(const char *src, const char *dst)
+// ubi_ctrl has dynamic misc minor, recreate /dev/ubi_ctrl from sysfs so that
+// ubiattach does not open a wrong device
+static void ubi_ctrl_node()
 {
-    int res = 0;
-    int src_fd = -1;
-    int dst_fd = -1;
-    struct stat st;
-    int count, src_rb, dst_b;
-    char src_buf[4096];
-    char dst_buf[4096];
-
-    if ((src_fd = open(src, O_RDONLY)) < 0) {
-        goto err_open_src;
-    }
+    char buf[32];
+    unsigned int maj, min;
+    int fd, rb;
 
-    if ((dst_fd = open(dst, O_RDWR | O_CREAT, 00644)) < 0) {
-        goto err_open_dst;
+    if ((fd = open("/sys/class/misc/ubi_ctrl/dev", O_RDONLY)) < 0) {
+        perror("open /sys/class/misc/ubi_ctrl/dev");
+        return;
     }
-
-    if (fstat(src_fd, &st) < 0) {
-        goto err_stat;
+    rb = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (rb <= 0 || (buf[rb] = 0, sscanf(buf, "%u:%u", &maj, &min) != 2)) {
+        printf("ubi_ctrl device number not found\n");
+        return;
     }
-    // Make sure src and dst have same length
-    if (ftruncate(dst_fd, st.st_size) < 0) {
-        goto err_truncate;
+    unlink("/dev/ubi_ctrl");
+    if (mknod("/dev/ubi_ctrl", S_IFCHR | 0644, makedev(maj, min)) < 0) {
+        perror("mknod /dev/ubi_ctrl");
     }
+}
+
+// Copy src_fd content to dst_fd. On error returns negative error code.
+static int copy_fd(int src_fd, int dst_fd)
+{
+    int count, src_rb, dst_b;
+    char buf[4096];
 
     for (;;) {
-        src_rb = read(src_fd, src_buf, 4096);
+        src_rb = read(src_fd, buf, 4096);
         if (src_rb < 0) {
-            goto err_read_src;
+            goto err_read;
         }
         if (src_rb == 0) {
             break;
         }
         dst_b = 0;
         do {
-            if ((count = read(dst_fd, dst_buf + dst_b, src_rb - dst_b)) < 0) {
-                goto err_read_dst;
-            }
-            dst_b += count;
-        } while (dst_b < src_rb);
-
-        if (memcmp(src_buf, dst_buf, src_rb) == 0) {
-            continue;
-        }
-        res = 1;
-        if (lseek(dst_fd, -src_rb, SEEK_CUR) < 0) {
-            goto err_seek;
-        }
-        dst_b = 0;
-        do {
-            if ((count = write(dst_fd, src_buf + dst_b, src_rb - dst_b)) < 0) {
+            if ((count = write(dst_fd, buf + dst_b, src_rb - dst_b)) < 0) {
                 goto err_write;
             }
             dst_b += count;
         }
         while (dst_b < src_rb);
     }
+    return 0;
 
-cleanup:
-    if (src_fd > 0) {
-        close(src_fd);
+err_read:
+    perror("read failed");
+    return -1;
+
+err_write:
+    perror("write failed");
+    return -2;
+}
+
+// Kernel slots on FAT. Bootloader loads the slot named in kernel.env, e.g.
+// "kernel=uImage-a", and passes it on kernel command line as
+// kernelslot=uImage-a (see scripts/boot.txt). Without kernelslot the boot
+// script is an old one which always loads the legacy /fat/uImage.
+#define KERNEL_LEGACY "uImage"
+#define KERNEL_SLOT_A "uImage-a"
+#define KERNEL_SLOT_B "uImage-b"
+#define KERNEL_TMP "uImage.tmp"
+#define KERNEL_ENV "gta04-init/kernel.env"
+#define KERNEL_ENV_TMP "gta04-init/kernel.env.tmp"
+
+// Cheap check if kernel in src_fd differs from path: compare size and first
+// block. The first block holds uImage header with data CRC and timestamp, so
+// any rebuilt kernel differs there.
+static int kernel_changed(int src_fd, const char *path)
+{
+    struct stat src_st;
+    struct stat dst_st;
+    char src_buf[4096];
+    char dst_buf[4096];
+    int src_rb, dst_rb;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return 1;
     }
-    if (dst_fd > 0) {
-        close(dst_fd);
+    if (fstat(src_fd, &src_st) < 0 || fstat(fd, &dst_st) < 0) {
+        perror("stat failed");
+        close(fd);
+        return 1;
     }
-    return res;
-
-err_src:
-    res = -1;
-    printf("file %s ", src);
-    goto cleanup;
+    src_rb = pread(src_fd, src_buf, 4096, 0);
+    dst_rb = pread(fd, dst_buf, 4096, 0);
+    close(fd);
+    return src_st.st_size != dst_st.st_size || src_rb <= 0 ||
+        src_rb != dst_rb || memcmp(src_buf, dst_buf, src_rb) != 0;
+}
 
-err_dst:
-    res = -2;
-    printf("file %s ", dst);
-    goto cleanup;
+// Copy kernel from src_fd to target. The current directory must be FAT root.
+// Kernel is written to a temporary file first and renamed, so the target is
+// either old or new kernel, never partial. With use_env kernel.env is switched
+// to target afterwards, so the booted slot is never written at all.
+static int kernel_stage(int src_fd, const char *target, int use_env)
+{
+    char env[64];
+    long start = fb_usecs();
+    int fd, res, len;
 
-err_open_src:
-    perror("open failed");
-    goto err_src;
+    if ((fd = open(KERNEL_TMP, O_WRONLY | O_CREAT | O_TRUNC, 00644)) < 0) {
+        perror(KERNEL_TMP);
+        return -2;
+    }
+    res = copy_fd(src_fd, fd);
+    if (res >= 0 && fsync(fd) < 0) {
+        perror(KERNEL_TMP);
+        res = -2;
+    }
+    close(fd);
+    if (res < 0) {
+        unlink(KERNEL_TMP);
+        return res;
+    }
+    if (rename(KERNEL_TMP, target) < 0) {
+        perror(target);
+        return -2;
+    }
 
-err_stat:
-    perror("stat failed");
-    goto err_src;
+    // Switch slots atomically - kernel.env is either old or new, never partial
+    if (use_env) {
+        len = snprintf(env, sizeof(env), "kernel=%s\n", target);
+        if ((fd = open(KERNEL_ENV_TMP, O_WRONLY | O_CREAT | O_TRUNC,
+                       00644)) < 0) {
+            perror(KERNEL_ENV_TMP);
+            return -2;
+        }
+        if (write(fd, env, len) != len || fsync(fd) < 0) {
+            perror(KERNEL_ENV_TMP);
+            close(fd);
+            return -2;
+        }
+        close(fd);
+        if (rename(KERNEL_ENV_TMP, KERNEL_ENV) < 0) {
+            perror("rename " KERNEL_ENV);
+            return -2;
+        }
+    }
+    sync();
+    printf("kernel %s activated for next boot in %ld us\n", target,
+           fb_usecs() - start);
+    return 1;
+}
 
-err_truncate:
-    perror("truncate failed");
-    goto err_dst;
+#define KERNEL_STAGE_MNT ".gta04-fat"
+
+// If kernel in uimage_path differs from the booted one, stage it to FAT in
+// low priority child process so that boot continues with running kernel. FAT
+// mount is then moved to /dev/.gta04-fat on the new root, so the distro sees
+// p1 as mounted in /proc/mounts and mounting it again shares the same
+// filesystem, until the child unmounts it. Child keeps kernel file and dirs
+// open, so it survives moving of /real-root. It runs while the distro owns
+// the screen, so it does not draw anything. Returns 0 if the FAT mount was
+// taken over.
+static int kernel_stage_bg(const char *uimage_path, const char *dev_path)
+{
+    char fat_path[256];
+    char active_path[256];
+    const char *active = getenv("kernelslot");
+    const char *target;
+    int use_env;
+    int src_fd = -1;
+    int fat_fd = -1;
+    int dev_fd = -1;
+    int res = -1;
+    pid_t pid;
 
-err_open_dst:
-    perror("open failed");
-    goto err_dst;
+    if (active && (strcmp(active, KERNEL_SLOT_A) == 0 ||
+                   strcmp(active, KERNEL_SLOT_B) == 0 ||
+                   strcmp(active, KERNEL_LEGACY) == 0)) {
+        target = strcmp(active, KERNEL_SLOT_A) ? KERNEL_SLOT_A : KERNEL_SLOT_B;
+        use_env = 1;
+    } else {
+        printf("WARNING: boot script does not pass kernelslot, kernel slots "
+               "are not used. Install scripts/boot.txt as boot.scr\n");
+        active = target = KERNEL_LEGACY;
+        use_env = 0;
+    }
 
-err_read_src:
-    perror("read failed");
-    goto err_src;
+    if ((src_fd = open(uimage_path, O_RDONLY)) < 0) {
+        perror(uimage_path);
+        goto cleanup;
+    }
+    snprintf(active_path, 256, "/fat/%s", active);
+    if (!kernel_changed(src_fd, active_path)) {
+        printf("kernel %s is up to date\n", active);
+        goto cleanup;
+    }
+    printf("staging kernel to %s\n", target);
+    if (!use_env) {
+        fb_text(FB_STATUS_LEFT, FB_STATUS_TOP, FB_STATUS_WIDTH,
+                "Old boot.scr, see README");
+    }
 
-err_read_dst:
-    perror("read failed");
-    goto err_dst;
+    snprintf(fat_path, 256, "%s/" KERNEL_STAGE_MNT, dev_path);
+    if ((fat_fd = open("/fat/gta04-init", O_RDONLY | O_DIRECTORY)) < 0) {
+        perror("/fat/gta04-init");
+        goto cleanup;
+    }
+    if ((dev_fd = open(dev_path, O_RDONLY | O_DIRECTORY)) < 0) {
+        perror(dev_path);
+        goto cleanup;
+    }
+    if (mkdir(fat_path, 0755) < 0 && errno != EEXIST) {
+        perror(fat_path);
+        goto cleanup;
+    }
+    if (mount("/fat", fat_path, NULL, MS_MOVE, NULL) < 0) {
+        perror("move /fat");
+        rmdir(fat_path);
+        goto cleanup;
+    }
 
-err_seek:
-    perror("seek failed");
-    goto err_dst;
+    fflush(stdout);
+    pid = fork();
+    if (pid == -1) {
+        // Give /fat back to the caller
+        perror("fork failed");
+        if (mount(fat_path, "/fat", NULL, MS_MOVE, NULL) < 0) {
+            perror("move /fat back");
+        }
+        rmdir(fat_path);
+        goto cleanup;
+    }
+    if (pid == 0) {
+        fb_close();
+        if (nice(19) == -1) {
+            perror("nice failed");
+        }
+        if (fchdir(fat_fd) < 0 || chdir("..") < 0) {
+            perror("chdir fat failed");
+            res = -1;
+        } else {
+            res = kernel_stage(src_fd, target, use_env);
+        }
+        // Paths from before handoff are gone, unmount through new root /dev
+        if (fchdir(dev_fd) < 0 ||
+            (umount(KERNEL_STAGE_MNT) < 0 &&
+             umount2(KERNEL_STAGE_MNT, MNT_DETACH) < 0)) {
+            perror("umount " KERNEL_STAGE_MNT);
+        }
+        rmdir(KERNEL_STAGE_MNT);
+        fflush(stdout);
+        _exit(res < 0);
+    }
+    res = 0;
 
-err_write:
-    perror("write failed");
-    goto err_dst;
+cleanup:
+    if (dev_fd >= 0)
+        close(dev_fd);
+    if (fat_fd >= 0)
+        close(fat_fd);
+    if (src_fd >= 0)
+        close(src_fd);
+    return res;
 }
 
 static void run_rootfs_init(int update_kernel, const char *bootdev,
@@ -286,28 +476,9 @@ static void run_rootfs_init(int update_kernel, const char *bootdev,
     printf("chrootdir=%s\n", chrootdir);
     printf("bootdev_content=%s\n", bootdev_content);
 
-    // Check if we have the same kernel as on /real-root/boot
-    // If not copy it to uImage and reboot
-    if (update_kernel && update_file(uimage_path, "/fat/uImage") > 0) {
-        printf("updated kernel from real-root and rebooting\n");
-        write_file("/fat/gta04-init/bootdev", bootdev_content);
-        if (umount("/fat")) {
-            perror("umount /fat");
-        }
-        if (umount("/real-root")) {
-            perror("umount /real-root");
-        }
-        reboot(LINUX_REBOOT_CMD_RESTART);
-        sleep(60);
-        return;
-    }
     // Create lastbootdev so that distro knows how it was booted
     write_file("/fat/gta04-init/lastbootdev", bootdev_content);
 
-    // Unmount fat - we dont need it anymore
-    if (umount("/fat")) {
-        perror("umount /fat");
-    }
     // Draw distribution logo if supplied
     bmp_draw(logo_path, 176, 256, 1);
 
@@ -315,6 +486,16 @@ static void run_rootfs_init(int update_kernel, const char *bootdev,
     // automatically by kernel, we do it too to be compatible.
     mount_fs("devtmpfs", "none", dev_path);
 
+    // Check if we have the same kernel as on /real-root/boot. If not copy it
+    // to inactive kernel slot in background, it will be used on next boot.
+    // Staging child then owns fat mount and unmounts it when done.
+    if (!update_kernel || kernel_stage_bg(uimage_path, dev_path) < 0) {
+        // Unmount fat - we dont need it anymore
+        if (umount("/fat")) {
+            perror("umount /fat");
+        }
+    }
+
     err = run_init("/real-root", chrootdir, "/dev/console", "/sbin/init", argv);
     printf("run_init error: %s: %s\n", err, strerror(errno));
 }
@@ -337,6 +518,27 @@ int main(int argc, char *argv[], char **env)
     const char *choice_nand = "ubi0:rootfs";
     const char *bootdev = NULL;
     char *bootdir = NULL;       // optional directory to chroot to
+    struct fb_progress bar;
+    long start, draw_start;
+
+    // Boot scripts can report status with "/init fbtext message" and
+    // "/init fbprogress done total"
+    if (getpid() != 1 && argc > 2) {
+        if (fb_open() < 0) {
+            return 1;
+        }
+        if (strcmp(argv[1], "fbtext") == 0) {
+            fb_text(FB_STATUS_LEFT, FB_STATUS_TOP, FB_STATUS_WIDTH, argv[2]);
+        } else if (strcmp(argv[1], "fbprogress") == 0 && argc > 3) {
+            fb_progress_init(&bar, FB_STATUS_LEFT, FB_PROGRESS_TOP,
+                             FB_STATUS_WIDTH, FB_PROGRESS_HEIGHT);
+            fb_progress_set(&bar, atol(argv[2]), atol(argv[3]));
+        }
+        return 0;
+    }
+
+    // Keep fb mapped for status drawing until handoff to the distro
+    fb_open();
 
     // Check for realroot=/dev/xxx on kernel cmd line. This means we were
     // launched from uboot menu by taping the partition picture and we bootdev
@@ -388,18 +590,19 @@ int main(int argc, char *argv[], char **env)
     }
 
     // Let user select what he wants to boot
+    if (bootdev == NULL) {
+        menu_draw();
+    }
     while (bootdev == NULL) {
-        
-        bmp_draw("/pic/sd.bmp", 56, 96, 1);
-        bmp_draw("/pic/nand.bmp", 56 + 240, 96, 0);
-        bmp_draw("/pic/1.bmp", 56, 320 + 96, 0);
-        bmp_draw("/pic/2.bmp", 56 + 240, 320 + 96, 0);
-        
+
         if (fd < 0 && (fd = open("/dev/input/event0", O_RDWR)) < 0) {
             write_file("/dev/tty0", "failed to open touchscreen\n");
+            fb_text(FB_STATUS_LEFT, FB_MENU_STATUS_TOP, FB_STATUS_WIDTH,
+                    "No touchscreen");
             break;
         }
 
+        printf("waiting for touchscreen\n");
         rb = read(fd, &ev, sizeof(ev));
         if (rb < (int)sizeof(struct input_event)) {
             perror("short read");
@@ -460,6 +663,11 @@ int main(int argc, char *argv[], char **env)
         perror("mkdir /sys");
     }
     mount_fs("sysfs", "none", "/sys");
+    bmp_draw("/pic/nand.bmp", 176, 256, 1);
+    start = fb_usecs();
+    draw_start = fb_draw_usecs();
+    fb_text(FB_STATUS_LEFT, FB_STATUS_TOP, FB_STATUS_WIDTH, "Attaching UBI");
+    ubi_ctrl_node();
     pid = fork();
     if (pid == -1) {
         perror("fork failed");
@@ -475,7 +683,13 @@ int main(int argc, char *argv[], char **env)
         return 0;
     }
     for (;;) {
-        waitpid(pid, &ret, 0);
+        if (waitpid(pid, &ret, 0) == pid) {
+            printf("ubiattach status %d took %ld us, drawing %ld us\n",
+                   WIFEXITED(ret) ? WEXITSTATUS(ret) : -1,
+                   fb_usecs() - start, fb_draw_usecs() - draw_start);
+            fb_text(FB_STATUS_LEFT, FB_STATUS_TOP, FB_STATUS_WIDTH,
+                    "Mounting UBIFS");
+        }
         if (mount_fs("ubifs", bootdev, "/real-root") >= 0) {
             run_rootfs_init(0, bootdev, bootdir);
         }
@@ -11,6 +11,7 @@ echo "populating bin"
 
 # gta04-init mounts /dev/mmcblk0p1 as /fat for us
 echo "mounting squashfs"
+/init fbtext "mounting squashfs"
 mount -t squashfs -o loop /fat/qtmoko-debian-gta04-v42.squashfs /real-root
 
 echo "mounting sysfs"
@@ -26,8 +27,15 @@ echo "mounting tmp"
 mount -t tmpfs none /real-root/tmp
 
 echo "copying files to var"
+/init fbtext "copying files to var"
 mkdir -p /real-root/tmp/var
-cp -r /real-root/var/* /real-root/tmp/var
+set -- /real-root/var/*
+count=0
+for f in "$@"; do
+    cp -r "$f" /real-root/tmp/var
+    count=$((count + 1))
+    /init fbprogress $count $#
+done
 
 echo "binding var"
 mount -o bind /real-root/tmp/var /real-root/var
@@ -37,6 +45,7 @@ mount -o bind /real-root/tmp/var /real-root/var
 /fat/gta04-init/busybox sleep 5
 
 echo "binding home"
+/init fbtext "starting QtMoko"
 mkdir -p /fat/qtmoko-squashfs/home
 mount -o bind /fat/qtmoko-squashfs/home /real-root/home
 